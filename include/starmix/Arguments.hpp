@@ -0,0 +1,87 @@
+// StarMix: A collection of programs which use the CANDIY suite
+// Copyright (C) Purdue University -- BSD license
+
+#ifndef STARMIX_ARGUMENTS_HPP
+#define STARMIX_ARGUMENTS_HPP
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace starmix {
+
+/// Command line of the tools which do not use `lemon::Options`: a fixed
+/// number of positional arguments followed by "--flag value" pairs.
+class Arguments {
+public:
+    Arguments(std::string usage, int positional)
+        : usage_(std::move(usage)), positional_(positional) {}
+
+    void option(const std::string& flag, std::string& value) {
+        options_[flag] = [&value](const std::string& text) {
+            value = text;
+        };
+    }
+
+    void option(const std::string& flag, int& value) {
+        options_[flag] = [&value, flag](const std::string& text) {
+            size_t used = 0;
+            try {
+                value = std::stoi(text, &used);
+            } catch (const std::logic_error&) {
+                used = 0;
+            }
+
+            if (used == 0 || used != text.size()) {
+                throw std::invalid_argument("Expected an integer for " + flag +
+                                            ", got '" + text + "'");
+            }
+        };
+    }
+
+    /// Reads the flags given in `argv`. Prints what is wrong and the usage,
+    /// then returns false, for missing arguments and unknown or bad flags.
+    bool parse(int argc, char** argv) {
+        if (argc < positional_ + 1) {
+            return error("Missing arguments");
+        }
+
+        for (int i = positional_ + 1; i < argc; i += 2) {
+            auto option = options_.find(argv[i]);
+            if (option == options_.end()) {
+                return error(std::string("Unknown option ") + argv[i]);
+            }
+
+            if (i + 1 >= argc) {
+                return error(std::string("Missing value for ") + argv[i]);
+            }
+
+            try {
+                option->second(argv[i + 1]);
+            } catch (const std::invalid_argument& e) {
+                return error(e.what());
+            }
+        }
+
+        return true;
+    }
+
+    /// Prints `message` and the usage, always returns false
+    bool error(const std::string& message) const {
+        std::cerr << "Error: " << message << "\n"
+                  << "Usage: " << usage_ << std::endl;
+        return false;
+    }
+
+private:
+    std::string usage_;
+    int positional_;
+    std::map<std::string, std::function<void(const std::string&)>> options_;
+};
+
+}
+
+#endif
@@ -0,0 +1,318 @@
+// StarMix: A collection of programs which use the CANDIY suite
+// Copyright (C) Purdue University -- BSD license
+
+#ifndef STARMIX_DISTANCE_HISTOGRAM_HPP
+#define STARMIX_DISTANCE_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "starmix/OutputBuffer.hpp"
+
+namespace starmix {
+
+/// Distance counts for a single type pair.
+///
+/// Counts are first gathered in a hash map, then `compress` stores only the
+/// occupied bins as a sorted vector. Merging two compressed histograms is a
+/// single linear pass.
+class PairHistogram {
+public:
+    using Bins = std::vector<std::pair<size_t, size_t>>;
+
+    void add(size_t bin, size_t count = 1) {
+        pending_[bin] += count;
+    }
+
+    void compress() {
+        if (pending_.empty()) {
+            return;
+        }
+
+        Bins added(pending_.begin(), pending_.end());
+        std::sort(added.begin(), added.end());
+        pending_.clear();
+        merge_bins(added);
+    }
+
+    /// Adds the counts of `other`, which must be compressed
+    void merge(const PairHistogram& other) {
+        compress();
+        merge_bins(other.bins_);
+    }
+
+    /// Occupied bins sorted by bin index
+    const Bins& bins() const { return bins_; }
+
+    size_t total() const {
+        size_t sum = 0;
+        for (const auto& bin : bins_) {
+            sum += bin.second;
+        }
+        return sum;
+    }
+
+private:
+    void merge_bins(const Bins& other) {
+        if (bins_.empty()) {
+            bins_ = other;
+            return;
+        }
+
+        Bins merged;
+        merged.reserve(bins_.size() + other.size());
+
+        auto a = bins_.begin();
+        auto b = other.begin();
+        while (a != bins_.end() || b != other.end()) {
+            if (b == other.end() || (a != bins_.end() && a->first < b->first)) {
+                merged.push_back(*a++);
+            } else if (a == bins_.end() || b->first < a->first) {
+                merged.push_back(*b++);
+            } else {
+                merged.emplace_back(a->first, a->second + b->second);
+                ++a;
+                ++b;
+            }
+        }
+
+        bins_.swap(merged);
+    }
+
+    Bins bins_;
+    std::unordered_map<size_t, size_t> pending_;
+};
+
+/// Distance histograms for every type pair seen
+class DistanceHistograms {
+public:
+    void add(const std::string& pair, size_t bin) {
+        pairs_[pair].add(bin);
+    }
+
+    /// Must be called before the histograms are merged into another set
+    void compress() {
+        for (auto& pair : pairs_) {
+            pair.second.compress();
+        }
+    }
+
+    void merge(const DistanceHistograms& other) {
+        for (const auto& pair : other.pairs_) {
+            pairs_[pair.first].merge(pair.second);
+        }
+    }
+
+    bool empty() const { return pairs_.empty(); }
+
+    std::map<std::string, PairHistogram>::const_iterator begin() const {
+        return pairs_.begin();
+    }
+
+    std::map<std::string, PairHistogram>::const_iterator end() const {
+        return pairs_.end();
+    }
+
+private:
+    std::map<std::string, PairHistogram> pairs_;
+};
+
+/// Collector for `lemon::launch` merging the histograms of every worker
+class histogram_combine {
+public:
+    explicit histogram_combine(DistanceHistograms& total) : total_(total) {}
+
+    void operator()(const DistanceHistograms& histograms) {
+        total_.merge(histograms);
+    }
+
+    template <typename Container>
+    void operator()(const Container& histograms) {
+        for (const auto& item : histograms) {
+            (*this)(item);
+        }
+    }
+
+private:
+    DistanceHistograms& total_;
+};
+
+/// Writes one "pair, distance, count" row per bin, at the lower edge of the
+/// bin. Pairs with fewer than `min_pair_count` observations are left out.
+///
+/// With a `min_bin_count` above one, runs of neighboring bins are merged until
+/// they hold at least that many observations, as long as a run spans at most
+/// `max_bin_width` (ten bins if zero). Runs which cannot reach the count
+/// within that width are kept as they are. The count of a run is spread
+/// evenly back over the bins it covers, so the rows stay on the `bin_size`
+/// grid and every pair keeps its total.
+inline void write_histograms(OutputWriter& out, const DistanceHistograms& histograms,
+                             double bin_size, size_t min_bin_count = 0,
+                             size_t min_pair_count = 0, double max_bin_width = 0) {
+    size_t max_bins = 10;
+    if (max_bin_width > 0) {
+        max_bins = std::max<size_t>(1, static_cast<size_t>(
+            std::floor(max_bin_width / bin_size + 1e-9)));
+    }
+
+    auto write_bin = [&](const std::string& pair, size_t bin, size_t count) {
+        out << pair << "\t" << static_cast<double>(bin) * bin_size << "\t"
+            << count << "\n";
+    };
+
+    for (const auto& pair : histograms) {
+        if (pair.second.total() < min_pair_count) {
+            continue;
+        }
+
+        const auto& bins = pair.second.bins();
+
+        if (min_bin_count <= 1) {
+            for (const auto& bin : bins) {
+                write_bin(pair.first, bin.first, bin.second);
+            }
+            continue;
+        }
+
+        auto run = bins.begin();
+        while (run != bins.end()) {
+            auto first = run->first;
+            auto last = first;
+            size_t count = 0;
+
+            auto next = run;
+            while (next != bins.end() && next->first - first < max_bins &&
+                   count < min_bin_count) {
+                last = next->first;
+                count += next->second;
+                ++next;
+            }
+
+            // Bin i of the run gets floor((i + 1) * count / n) - floor(i * count / n)
+            auto width = last - first + 1;
+            size_t written = 0;
+            for (size_t i = 0; i < width; ++i) {
+                auto upto = (i + 1) * count / width;
+                if (upto != written) {
+                    write_bin(pair.first, first + i, upto - written);
+                    written = upto;
+                }
+            }
+
+            run = next;
+        }
+    }
+}
+
+/// Checks the settings of `write_densities`, throws `std::invalid_argument`
+inline void check_density_settings(double bandwidth, double step, double max_dist) {
+    if (!std::isfinite(bandwidth) || bandwidth <= 0) {
+        throw std::invalid_argument("The bandwidth must be a positive number");
+    }
+
+    if (!std::isfinite(step) || step <= 0) {
+        throw std::invalid_argument("The density step must be a positive number");
+    }
+
+    if (!std::isfinite(max_dist) || max_dist < 0 || max_dist / step > 1e8) {
+        throw std::invalid_argument("The density needs 0 <= max_dist / step <= 1e8");
+    }
+}
+
+/// Writes a Gaussian kernel density estimate of every pair, sampled every
+/// `step` from 0 to `max_dist`, in the same "pair, distance, count" layout as
+/// `write_histograms`. Each bin is placed at its lower edge and its count is
+/// spread over the samples within four bandwidths. The smoothed counts of a
+/// pair are rounded to integers with the largest remainder method, so they
+/// still add up to its number of observations. Samples with a zero count are
+/// left out, as are pairs with fewer than `min_pair_count` observations.
+inline void write_densities(OutputWriter& out, const DistanceHistograms& histograms,
+                            double bin_size, double bandwidth, double step,
+                            double max_dist, size_t min_pair_count = 0) {
+    check_density_settings(bandwidth, step, max_dist);
+
+    const auto samples = static_cast<size_t>(std::floor(max_dist / step)) + 1;
+    const auto reach = 4.0 * bandwidth;
+
+    std::vector<double> density(samples);
+    std::vector<size_t> counts(samples);
+    std::vector<double> weights;
+    std::vector<size_t> order;
+    for (const auto& pair : histograms) {
+        auto total = pair.second.total();
+        if (total < min_pair_count) {
+            continue;
+        }
+
+        std::fill(density.begin(), density.end(), 0.0);
+
+        for (const auto& bin : pair.second.bins()) {
+            auto distance = static_cast<double>(bin.first) * bin_size;
+            auto first = static_cast<size_t>(
+                std::max(0.0, std::ceil((distance - reach) / step)));
+            auto last = static_cast<size_t>(
+                std::min(static_cast<double>(samples - 1),
+                         std::floor((distance + reach) / step)));
+
+            // No sample within reach: keep the counts at the closest sample
+            if (first > last || distance - reach > max_dist) {
+                auto closest = std::min(static_cast<double>(samples - 1),
+                                        std::round(distance / step));
+                density[static_cast<size_t>(closest)] += static_cast<double>(bin.second);
+                continue;
+            }
+
+            weights.clear();
+            double sum = 0;
+            for (auto i = first; i <= last; ++i) {
+                auto z = (static_cast<double>(i) * step - distance) / bandwidth;
+                weights.push_back(std::exp(-0.5 * z * z));
+                sum += weights.back();
+            }
+
+            auto scale = static_cast<double>(bin.second) / sum;
+            for (auto i = first; i <= last; ++i) {
+                density[i] += weights[i - first] * scale;
+            }
+        }
+
+        // Largest remainder rounding: every sample gets the integer part of
+        // its count, the samples with the largest fractions get the rest
+        size_t assigned = 0;
+        order.clear();
+        for (size_t i = 0; i < samples; ++i) {
+            counts[i] = static_cast<size_t>(std::floor(density[i]));
+            assigned += counts[i];
+            if (density[i] > static_cast<double>(counts[i])) {
+                order.push_back(i);
+            }
+        }
+
+        auto missing = std::min(total > assigned ? total - assigned : 0, order.size());
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            auto fa = density[a] - static_cast<double>(counts[a]);
+            auto fb = density[b] - static_cast<double>(counts[b]);
+            return fa > fb || (fa == fb && a < b);
+        });
+        for (size_t i = 0; i < missing; ++i) {
+            ++counts[order[i]];
+        }
+
+        for (size_t i = 0; i < samples; ++i) {
+            if (counts[i] != 0) {
+                out << pair.first << "\t" << static_cast<double>(i) * step << "\t"
+                    << counts[i] << "\n";
+            }
+        }
+    }
+}
+
+}
+
+#endif
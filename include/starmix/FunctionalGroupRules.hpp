@@ -0,0 +1,358 @@
+// StarMix: A collection of programs which use the CANDIY suite
+// Copyright (C) Purdue University -- BSD license
+
+#ifndef STARMIX_FUNCTIONAL_GROUP_RULES_HPP
+#define STARMIX_FUNCTIONAL_GROUP_RULES_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "spear/Molecule.hpp"
+#include "spear/FunctionalGroup.hpp"
+#include "chemfiles.hpp"
+
+namespace starmix {
+
+/// A set of functional group rules applied to molecules in a single pass.
+///
+/// Rules are read one per line, blank lines and lines starting with '#' are
+/// ignored:
+///
+///     require        NAME SMARTS              keep only molecules matching SMARTS
+///     reject         NAME SMARTS              drop molecules matching SMARTS
+///     charge         NAME SMARTS ATOM CHARGE  set the formal charge of pattern
+///                                             atom ATOM (counted from 0) in
+///                                             every match
+///     max_components NAME COUNT               drop molecules with more than
+///                                             COUNT connected components
+///
+/// Identical SMARTS are compiled once and matched at most once per molecule,
+/// however many rules use them. Before matching, the elements a pattern needs
+/// are compared with the molecule's composition, so patterns naming elements
+/// the molecule lacks are ruled out without searching the graph. Patterns
+/// which pass this check are still searched one by one, so the cost per
+/// molecule grows with the number of distinct patterns. Every rule sees the
+/// input molecule; the charge edits are only applied once the molecule passed
+/// all filters.
+class FunctionalGroupRules {
+public:
+    explicit FunctionalGroupRules(std::istream& input) {
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(input, line)) {
+            ++line_number;
+
+            std::stringstream ss(line);
+            std::string action;
+            if (!(ss >> action) || action[0] == '#') {
+                continue;
+            }
+
+            Rule rule;
+            rule.line = line_number;
+            std::string smarts;
+            bool valid = static_cast<bool>(ss >> rule.name);
+
+            if (action == "require" || action == "reject") {
+                rule.action = action == "require" ? REQUIRE : REJECT;
+                valid = valid && (ss >> smarts);
+            } else if (action == "charge") {
+                rule.action = CHARGE;
+                valid = valid && (ss >> smarts >> rule.atom >> rule.charge);
+            } else if (action == "max_components") {
+                rule.action = MAX_COMPONENTS;
+                valid = valid && (ss >> rule.components);
+            } else {
+                throw std::runtime_error("Unknown rule '" + action + "' on line " +
+                                         std::to_string(line_number));
+            }
+
+            if (!valid) {
+                throw std::runtime_error("Malformed rule on line " +
+                                         std::to_string(line_number));
+            }
+
+            if (!smarts.empty()) {
+                rule.pattern = add_pattern(smarts);
+            }
+
+            if (rule.action == CHARGE && rule.atom >= pattern_atoms_[rule.pattern]) {
+                throw std::runtime_error("Charge rule on line " + std::to_string(line_number) +
+                                         " names atom " + std::to_string(rule.atom) +
+                                         " but its pattern has " +
+                                         std::to_string(pattern_atoms_[rule.pattern]) +
+                                         " atoms");
+            }
+
+            rules_.push_back(rule);
+        }
+    }
+
+    /// Number of rules
+    size_t size() const { return rules_.size(); }
+
+    /// Number of distinct SMARTS patterns used by the rules
+    size_t patterns() const { return patterns_.size(); }
+
+    /// Checks every rule against `frame` and applies the charge edits if the
+    /// molecule is kept. Returns the name of the rule which removed the
+    /// molecule, or an empty string if it is kept.
+    std::string apply(chemfiles::Frame& frame) const {
+        auto mol = Spear::Molecule(frame);
+
+        std::unordered_map<std::string, size_t> composition;
+        for (size_t i = 0; i < frame.size(); ++i) {
+            ++composition[element(frame[i].type())];
+        }
+
+        std::vector<std::unique_ptr<GroupMatches>> matches(patterns_.size());
+        std::vector<bool> searched(patterns_.size(), false);
+
+        auto match = [&](size_t pattern) -> const GroupMatches* {
+            if (!searched[pattern]) {
+                searched[pattern] = true;
+                if (may_match(pattern, composition)) {
+                    matches[pattern] = std::make_unique<GroupMatches>(
+                        find_functional_groups(mol, *patterns_[pattern]));
+                }
+            }
+            return matches[pattern].get();
+        };
+
+        for (const auto& rule : rules_) {
+            if (rule.action == MAX_COMPONENTS &&
+                mol.connected_components() > rule.components) {
+                return rule.name;
+            }
+
+            if (rule.action == REQUIRE) {
+                auto found = match(rule.pattern);
+                if (found == nullptr || found->size() == 0) {
+                    return rule.name;
+                }
+            }
+
+            if (rule.action == REJECT) {
+                auto found = match(rule.pattern);
+                if (found != nullptr && found->size() != 0) {
+                    return rule.name;
+                }
+            }
+        }
+
+        for (const auto& rule : rules_) {
+            if (rule.action != CHARGE) {
+                continue;
+            }
+
+            auto found = match(rule.pattern);
+            if (found == nullptr) {
+                continue;
+            }
+
+            for (const auto& group : *found) {
+                if (rule.atom >= group.size()) {
+                    throw std::runtime_error("Charge rule on line " +
+                                             std::to_string(rule.line) +
+                                             " names an atom past the end of its match");
+                }
+                frame[group[rule.atom]].set_charge(rule.charge);
+            }
+        }
+
+        return "";
+    }
+
+private:
+    using GroupMatches = decltype(find_functional_groups(
+        std::declval<Spear::Molecule&>(), std::declval<Spear::FunctionalGroup&>()));
+
+    enum Action {
+        REQUIRE,
+        REJECT,
+        CHARGE,
+        MAX_COMPONENTS,
+    };
+
+    struct Rule {
+        Action action;
+        std::string name;
+        size_t line = 0;
+        size_t pattern = 0;
+        size_t atom = 0;
+        double charge = 0;
+        size_t components = 0;
+    };
+
+    using Composition = std::vector<std::pair<std::string, size_t>>;
+
+    size_t add_pattern(const std::string& smarts) {
+        auto existing = pattern_ids_.find(smarts);
+        if (existing != pattern_ids_.end()) {
+            return existing->second;
+        }
+
+        size_t atoms = 0;
+        patterns_.emplace_back(std::make_unique<Spear::FunctionalGroup>(smarts));
+        requirements_.push_back(scan_smarts(smarts, atoms));
+        pattern_atoms_.push_back(atoms);
+        pattern_ids_[smarts] = patterns_.size() - 1;
+        return patterns_.size() - 1;
+    }
+
+    bool may_match(size_t pattern,
+                   const std::unordered_map<std::string, size_t>& composition) const {
+        for (const auto& needed : requirements_[pattern]) {
+            auto available = composition.find(needed.first);
+            if (available == composition.end() || available->second < needed.second) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Element symbol of an atom type: SYBYL suffixes such as 'C.ar' are
+    // dropped and the case is normalized, so 'CL' and 'cl' both give 'Cl'
+    static std::string element(const std::string& type) {
+        auto symbol = type.substr(0, type.find('.'));
+        for (size_t i = 0; i < symbol.size(); ++i) {
+            auto c = static_cast<unsigned char>(symbol[i]);
+            symbol[i] = static_cast<char>(i == 0 ? std::toupper(c) : std::tolower(c));
+        }
+        return symbol;
+    }
+
+    // Each pattern atom matches a different molecule atom, so the atoms which
+    // always name one element give a lower bound on the composition of any
+    // matching molecule. These are the atoms outside of brackets and the
+    // bracket atoms without lists, negations or recursion, such as '[OH1]',
+    // '[N+]' or '[#7]'. Other atoms are conservatively ignored.
+    // `atoms` is set to the number of atoms in the pattern.
+    static Composition scan_smarts(const std::string& smarts, size_t& atoms) {
+        std::unordered_map<std::string, size_t> counts;
+        atoms = 0;
+
+        for (size_t i = 0; i < smarts.size(); ++i) {
+            auto c = smarts[i];
+
+            if (c == '[') {
+                // Recursive SMARTS can nest brackets
+                size_t depth = 1;
+                auto end = i + 1;
+                for (; end < smarts.size() && depth != 0; ++end) {
+                    depth += smarts[end] == '[' ? 1 : 0;
+                    depth -= smarts[end] == ']' ? 1 : 0;
+                }
+
+                auto symbol = bracket_element(smarts.substr(i + 1, end - i - 2));
+                if (!symbol.empty()) {
+                    ++counts[symbol];
+                }
+                ++atoms;
+                i = end - 1;
+                continue;
+            }
+
+            auto next = i + 1 < smarts.size() ? smarts[i + 1] : '\0';
+            if ((c == 'C' && next == 'l') || (c == 'B' && next == 'r')) {
+                ++counts[std::string{c, next}];
+                ++atoms;
+                ++i;
+                continue;
+            }
+
+            switch (c) {
+            case 'B': case 'C': case 'N': case 'O': case 'P': case 'S': case 'F': case 'I':
+                ++counts[std::string(1, c)];
+                ++atoms;
+                break;
+            case 'b': case 'c': case 'n': case 'o': case 'p': case 's':
+                ++counts[std::string(1, static_cast<char>(std::toupper(c)))];
+                ++atoms;
+                break;
+            case '*': case 'A': case 'a':
+                ++atoms;
+                break;
+            default:
+                break;
+            }
+        }
+
+        return Composition(counts.begin(), counts.end());
+    }
+
+    // Element required by the contents of a bracket atom, or an empty string
+    // if it can match several elements. Hydrogen is never required, as the
+    // molecules may not list their hydrogens explicitly.
+    static std::string bracket_element(const std::string& atom) {
+        static const char* symbols[] = {
+            "",   "H",  "He", "Li", "Be", "B",  "C",  "N",  "O",  "F",  "Ne",
+            "Na", "Mg", "Al", "Si", "P",  "S",  "Cl", "Ar", "K",  "Ca", "Sc",
+            "Ti", "V",  "Cr", "Mn", "Fe", "Co", "Ni", "Cu", "Zn", "Ga", "Ge",
+            "As", "Se", "Br", "Kr", "Rb", "Sr", "Y",  "Zr", "Nb", "Mo", "Tc",
+            "Ru", "Rh", "Pd", "Ag", "Cd", "In", "Sn", "Sb", "Te", "I",  "Xe",
+        };
+        const auto known = sizeof(symbols) / sizeof(symbols[0]);
+
+        if (atom.find_first_of(",!$") != std::string::npos) {
+            return "";
+        }
+
+        auto is_element = [&](const std::string& symbol) {
+            return std::find(symbols + 2, symbols + known, symbol) != symbols + known;
+        };
+
+        // Skip an isotope
+        size_t i = 0;
+        while (i < atom.size() && std::isdigit(static_cast<unsigned char>(atom[i]))) {
+            ++i;
+        }
+
+        if (i < atom.size() && atom[i] == '#') {
+            size_t number = 0;
+            for (++i; i < atom.size() && std::isdigit(static_cast<unsigned char>(atom[i])); ++i) {
+                number = number * 10 + static_cast<size_t>(atom[i] - '0');
+            }
+            return number > 1 && number < known ? symbols[number] : "";
+        }
+
+        if (i >= atom.size() || !std::isalpha(static_cast<unsigned char>(atom[i]))) {
+            return "";
+        }
+
+        // Aromatic atoms are written in lower case, as in 'se' or 'c'
+        auto aromatic = std::islower(static_cast<unsigned char>(atom[i])) != 0;
+        std::string symbol(1, static_cast<char>(std::toupper(static_cast<unsigned char>(atom[i]))));
+
+        if (i + 1 < atom.size() && std::islower(static_cast<unsigned char>(atom[i + 1]))) {
+            auto two = symbol + atom[i + 1];
+            if (aromatic ? (two == "Se" || two == "As") : is_element(two)) {
+                return two;
+            }
+        }
+
+        if (aromatic && std::string("bcnops").find(atom[i]) == std::string::npos) {
+            return "";
+        }
+
+        return is_element(symbol) ? symbol : "";
+    }
+
+    std::vector<Rule> rules_;
+    std::vector<std::unique_ptr<Spear::FunctionalGroup>> patterns_;
+    std::vector<Composition> requirements_;
+    std::vector<size_t> pattern_atoms_;
+    std::unordered_map<std::string, size_t> pattern_ids_;
+};
+
+}
+
+#endif
@@ -0,0 +1,520 @@
+// StarMix: A collection of programs which use the CANDIY suite
+// Copyright (C) Purdue University -- BSD license
+
+#ifndef STARMIX_LIGAND_READER_HPP
+#define STARMIX_LIGAND_READER_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chemfiles.hpp"
+
+namespace starmix {
+
+/// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        struct stat info;
+        if (::fstat(fd_, &info) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("Could not stat " + path);
+        }
+
+        size_ = static_cast<size_t>(info.st_size);
+        mtime_ = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+                 static_cast<int64_t>(info.st_mtim.tv_nsec);
+
+        if (size_ == 0) {
+            return;
+        }
+
+        auto mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("Could not map " + path);
+        }
+
+        ::madvise(mapping, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapping);
+    }
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+        ::close(fd_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    /// Modification time in nanoseconds
+    int64_t mtime() const { return mtime_; }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    int64_t mtime_ = 0;
+};
+
+/// Half-open range of record indices [begin, end)
+struct RecordRange {
+    size_t begin;
+    size_t end;
+};
+
+/// Random access to the records of a multi-molecule SDF or MOL2 file.
+///
+/// The file is memory mapped and the byte offset of every record is stored in
+/// an index. The index is cached next to the input as `<path>.idx` so later
+/// runs (or other nodes working on the same file) do not have to rescan it.
+class LigandReader {
+public:
+    explicit LigandReader(const std::string& path)
+        : file_(path), format_(format_for_path(path)) {
+        if (!read_index(path + ".idx")) {
+            build_index();
+            write_index(path + ".idx");
+        }
+    }
+
+    /// Whether `path` names a format this reader can index: uncompressed SDF
+    /// or MOL2. Other files have to be read with `chemfiles::Trajectory`.
+    static bool indexable(const std::string& path) {
+        return !format_name(path).empty();
+    }
+
+    /// Number of records in the file
+    size_t size() const { return offsets_.size() - 1; }
+
+    /// Chemfiles format name used to parse the records
+    const std::string& format() const { return format_; }
+
+    /// Byte offset of the start of record `i`, `offset(size())` is the end of file
+    size_t offset(size_t i) const { return offsets_[i]; }
+
+    /// Parse record `i` into a frame
+    chemfiles::Frame read(size_t i) const {
+        if (i >= size()) {
+            throw std::out_of_range("Record " + std::to_string(i) +
+                                    " is past the end of the file");
+        }
+
+        auto start = offsets_[i];
+        auto length = offsets_[i + 1] - start;
+        auto traj = chemfiles::Trajectory::memory_reader(file_.data() + start,
+                                                         length, format_);
+        return traj.read();
+    }
+
+private:
+    static std::string format_name(const std::string& path) {
+        auto dot = path.rfind('.');
+        auto ext = dot == std::string::npos ? std::string() : path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+        if (ext == "sdf" || ext == "sd" || ext == "mol") {
+            return "SDF";
+        }
+
+        if (ext == "mol2") {
+            return "MOL2";
+        }
+
+        return "";
+    }
+
+    static std::string format_for_path(const std::string& path) {
+        auto format = format_name(path);
+        if (!format.empty()) {
+            return format;
+        }
+
+        throw std::runtime_error("Unsupported ligand format for " + path +
+                                 ", expected an SDF or MOL2 file");
+    }
+
+    // An SDF record ends after its '$$$$' line, a MOL2 record starts at its
+    // '@<TRIPOS>MOLECULE' line. Comment lines directly above a MOL2 record
+    // (such as the '##########' headers written by DOCK) belong to it, any
+    // other text before the first record is skipped.
+    void build_index() {
+        const char* data = file_.data();
+        const size_t size = file_.size();
+        const bool sdf = format_ == "SDF";
+        const char* marker = sdf ? "$$$$" : "@<TRIPOS>MOLECULE";
+        const size_t marker_size = std::strlen(marker);
+        const size_t no_comment = static_cast<size_t>(-1);
+
+        offsets_.clear();
+        if (sdf) {
+            offsets_.push_back(0);
+        }
+
+        size_t comment = no_comment;
+        size_t line = 0;
+        while (line < size) {
+            auto newline = static_cast<const char*>(
+                std::memchr(data + line, '\n', size - line));
+            size_t next = newline == nullptr ? size
+                        : static_cast<size_t>(newline - data) + 1;
+
+            if (next - line >= marker_size &&
+                std::memcmp(data + line, marker, marker_size) == 0) {
+                if (sdf) {
+                    offsets_.push_back(next);
+                } else {
+                    offsets_.push_back(comment == no_comment ? line : comment);
+                }
+                comment = no_comment;
+            } else if (!sdf) {
+                if (data[line] == '#' || !has_content(line, next)) {
+                    comment = comment == no_comment ? line : comment;
+                } else {
+                    comment = no_comment;
+                }
+            }
+
+            line = next;
+        }
+
+        // Only whitespace after the last '$$$$' is not a record of its own
+        if (sdf && !has_content(offsets_.back(), size)) {
+            offsets_.pop_back();
+        }
+
+        offsets_.push_back(size);
+    }
+
+    bool has_content(size_t start, size_t stop) const {
+        for (auto i = start; i < stop; ++i) {
+            if (!std::isspace(static_cast<unsigned char>(file_.data()[i]))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static constexpr uint64_t INDEX_MAGIC = 0x32584449584D5453; // "STMXIDX2"
+
+    bool read_index(const std::string& index_path) {
+        std::ifstream input(index_path, std::ios::binary);
+        if (!input) {
+            return false;
+        }
+
+        uint64_t header[4];
+        if (!input.read(reinterpret_cast<char*>(header), sizeof(header))) {
+            return false;
+        }
+
+        if (header[0] != INDEX_MAGIC || header[1] != file_.size() ||
+            static_cast<int64_t>(header[2]) != file_.mtime() ||
+            header[3] == 0 || header[3] > file_.size() + 1) {
+            return false;
+        }
+
+        std::vector<uint64_t> offsets(header[3]);
+        if (!input.read(reinterpret_cast<char*>(offsets.data()),
+                        static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)))) {
+            return false;
+        }
+
+        if (offsets.back() != file_.size() ||
+            !std::is_sorted(offsets.begin(), offsets.end())) {
+            return false;
+        }
+
+        offsets_.assign(offsets.begin(), offsets.end());
+        return true;
+    }
+
+    // The cache is only an optimization, failing to write it is not an error.
+    // Shards started together all write it, so each one writes a private file
+    // and renames it over the cache, which replaces it atomically.
+    void write_index(const std::string& index_path) const {
+        auto temporary = index_path + ".tmp." + std::to_string(::getpid());
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        if (!output) {
+            return;
+        }
+
+        uint64_t header[4] = {INDEX_MAGIC, file_.size(),
+                              static_cast<uint64_t>(file_.mtime()),
+                              offsets_.size()};
+        std::vector<uint64_t> offsets(offsets_.begin(), offsets_.end());
+
+        output.write(reinterpret_cast<const char*>(header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(offsets.data()),
+                     static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+        output.close();
+
+        if (!output || std::rename(temporary.c_str(), index_path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+        }
+    }
+
+    MappedFile file_;
+    std::string format_;
+    std::vector<size_t> offsets_;
+};
+
+/// Parses the records of a range on a background thread so that reading
+/// overlaps with the work done on the previous frames.
+class PrefetchReader {
+public:
+    PrefetchReader(const LigandReader& reader, RecordRange range, size_t depth = 64)
+        : reader_(reader), range_(range), depth_(std::max<size_t>(depth, 1)) {
+        thread_ = std::thread([this] { produce(); });
+    }
+
+    ~PrefetchReader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        space_.notify_all();
+        thread_.join();
+    }
+
+    PrefetchReader(const PrefetchReader&) = delete;
+    PrefetchReader& operator=(const PrefetchReader&) = delete;
+
+    /// Moves the next frame into `frame`, returns false once the range is done
+    bool next(chemfiles::Frame& frame) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !queue_.empty() || done_; });
+
+        if (queue_.empty()) {
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            return false;
+        }
+
+        frame = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        space_.notify_one();
+        return true;
+    }
+
+private:
+    void produce() {
+        try {
+            for (auto i = range_.begin; i < range_.end; ++i) {
+                auto frame = reader_.read(i);
+
+                std::unique_lock<std::mutex> lock(mutex_);
+                space_.wait(lock, [this] { return queue_.size() < depth_ || stop_; });
+                if (stop_) {
+                    break;
+                }
+                queue_.push_back(std::move(frame));
+                lock.unlock();
+                ready_.notify_one();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        ready_.notify_all();
+    }
+
+    const LigandReader& reader_;
+    RecordRange range_;
+    size_t depth_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    std::deque<chemfiles::Frame> queue_;
+    std::exception_ptr error_;
+    bool done_ = false;
+    bool stop_ = false;
+
+    std::thread thread_;
+};
+
+// Non-negative integer making up all of `text`, `spec` is used in the error
+inline size_t parse_count(const std::string& text, const std::string& spec) {
+    if (text.empty() || text.size() > 18 ||
+        !std::all_of(text.begin(), text.end(), ::isdigit)) {
+        throw std::invalid_argument("Invalid number '" + text + "' in '" + spec + "'");
+    }
+    return static_cast<size_t>(std::stoull(text));
+}
+
+/// Records belonging to shard `i` of `N` (written "i/N", `i` counts from 0).
+/// Shards are contiguous, so each one maps to a single byte range of the file.
+inline RecordRange parse_shard(const std::string& spec, size_t count) {
+    auto slash = spec.find('/');
+    if (slash == std::string::npos) {
+        throw std::invalid_argument("Shard must be given as i/N, got '" + spec + "'");
+    }
+
+    auto shard = parse_count(spec.substr(0, slash), spec);
+    auto total = parse_count(spec.substr(slash + 1), spec);
+    if (total == 0 || shard >= total) {
+        throw std::invalid_argument("Shard '" + spec + "' needs 0 <= i < N");
+    }
+
+    return {count * shard / total, count * (shard + 1) / total};
+}
+
+/// Records selected by "start:end" (end excluded). Either side may be left
+/// empty to mean the start or the end of the file.
+inline RecordRange parse_range(const std::string& spec, size_t count) {
+    auto colon = spec.find(':');
+    if (colon == std::string::npos) {
+        throw std::invalid_argument("Range must be given as start:end, got '" + spec + "'");
+    }
+
+    auto first = spec.substr(0, colon);
+    auto last = spec.substr(colon + 1);
+
+    RecordRange range = {first.empty() ? 0 : parse_count(first, spec),
+                         last.empty() ? count : parse_count(last, spec)};
+    if (range.begin > range.end) {
+        throw std::invalid_argument("Range '" + spec + "' ends before it starts");
+    }
+
+    range.end = std::min(range.end, count);
+    range.begin = std::min(range.begin, range.end);
+    return range;
+}
+
+/// Applies `--range` and then `--shard` (either may be empty) to the records
+/// of `reader`. Throws `std::invalid_argument` for malformed specifications.
+inline RecordRange select_records(const LigandReader& reader,
+                                  const std::string& range,
+                                  const std::string& shard) {
+    RecordRange selected = {0, reader.size()};
+
+    if (!range.empty()) {
+        selected = parse_range(range, reader.size());
+    }
+
+    if (!shard.empty()) {
+        auto part = parse_shard(shard, selected.end - selected.begin);
+        selected = {selected.begin + part.begin, selected.begin + part.end};
+    }
+
+    return selected;
+}
+
+/// The ligands of one file, read in order. SDF and MOL2 files go through a
+/// `LigandReader` and a `PrefetchReader`, so `range` and `shard` (given as for
+/// `select_records`) can pick a part of them. Other formats, including
+/// compressed files, are read sequentially with `chemfiles::Trajectory` and
+/// must be read whole.
+///
+/// Throws `std::invalid_argument` for a bad or unsupported selection and the
+/// errors of `LigandReader` or chemfiles if the file can not be read.
+class LigandInput {
+public:
+    LigandInput(const std::string& path, const std::string& range,
+                const std::string& shard) : path_(path) {
+        if (LigandReader::indexable(path)) {
+            reader_ = std::make_unique<LigandReader>(path);
+            selected_ = select_records(*reader_, range, shard);
+            return;
+        }
+
+        if (!range.empty() || !shard.empty()) {
+            throw std::invalid_argument("--range and --shard need an uncompressed "
+                                        "SDF or MOL2 file, not " + path);
+        }
+
+        trajectory_ = std::make_unique<chemfiles::Trajectory>(path);
+    }
+
+    /// First molecule of the file, whatever the selection.
+    /// Throws `std::out_of_range` if the file is empty.
+    chemfiles::Frame first() {
+        if (reader_) {
+            return reader_->read(0);
+        }
+
+        if (!pending_ && trajectory_->done()) {
+            throw std::out_of_range("No molecules found in " + path_);
+        }
+
+        // Read once and handed out again by the first call to next()
+        if (!pending_) {
+            first_ = trajectory_->read();
+            pending_ = true;
+        }
+        return first_;
+    }
+
+    /// Moves the next selected frame into `frame`, returns false at the end
+    bool next(chemfiles::Frame& frame) {
+        if (reader_) {
+            if (!prefetch_) {
+                prefetch_ = std::make_unique<PrefetchReader>(*reader_, selected_);
+            }
+            return prefetch_->next(frame);
+        }
+
+        if (pending_) {
+            frame = std::move(first_);
+            pending_ = false;
+            return true;
+        }
+
+        if (trajectory_->done()) {
+            return false;
+        }
+
+        frame = trajectory_->read();
+        return true;
+    }
+
+private:
+    std::string path_;
+
+    std::unique_ptr<LigandReader> reader_;
+    RecordRange selected_ = {0, 0};
+    std::unique_ptr<PrefetchReader> prefetch_;
+
+    std::unique_ptr<chemfiles::Trajectory> trajectory_;
+    chemfiles::Frame first_;
+    bool pending_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,270 @@
+// StarMix: A collection of programs which use the CANDIY suite
+// Copyright (C) Purdue University -- BSD license
+
+#ifndef STARMIX_OUTPUT_BUFFER_HPP
+#define STARMIX_OUTPUT_BUFFER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace starmix {
+
+/// Growable text buffer with locale independent number formatting.
+///
+/// Doubles are written with a fixed number of decimals, 6 by default, and
+/// give the same text as `printf("%.*f")` (and so `std::to_string`).
+class OutputBuffer {
+public:
+    explicit OutputBuffer(int precision = 6) {
+        set_precision(precision);
+    }
+
+    /// Number of decimals, clamped to [0, 100]
+    void set_precision(int precision) {
+        precision_ = std::max(0, std::min(precision, 100));
+    }
+
+    int precision() const { return precision_; }
+
+    OutputBuffer& operator<<(double value) {
+        append_fixed(value);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(int value) { return append_signed(value); }
+    OutputBuffer& operator<<(long value) { return append_signed(value); }
+    OutputBuffer& operator<<(long long value) { return append_signed(value); }
+    OutputBuffer& operator<<(unsigned value) { return append_unsigned(value); }
+    OutputBuffer& operator<<(unsigned long value) { return append_unsigned(value); }
+    OutputBuffer& operator<<(unsigned long long value) { return append_unsigned(value); }
+
+    OutputBuffer& operator<<(char value) {
+        buffer_ += value;
+        return *this;
+    }
+
+    OutputBuffer& operator<<(const char* value) {
+        buffer_ += value;
+        return *this;
+    }
+
+    OutputBuffer& operator<<(const std::string& value) {
+        buffer_ += value;
+        return *this;
+    }
+
+    const char* data() const { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+    bool empty() const { return buffer_.empty(); }
+    void clear() { buffer_.clear(); }
+    void reserve(size_t capacity) { buffer_.reserve(capacity); }
+
+    void swap(OutputBuffer& other) {
+        buffer_.swap(other.buffer_);
+        std::swap(precision_, other.precision_);
+    }
+
+    void write(std::ostream& os) const {
+        os.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    }
+
+private:
+    OutputBuffer& append_unsigned(unsigned long long value) {
+        char digits[20];
+        auto end = digits + sizeof(digits);
+        auto begin = end;
+        do {
+            *--begin = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        buffer_.append(begin, end);
+        return *this;
+    }
+
+    OutputBuffer& append_signed(long long value) {
+        if (value < 0) {
+            buffer_ += '-';
+            return append_unsigned(0ULL - static_cast<unsigned long long>(value));
+        }
+        return append_unsigned(static_cast<unsigned long long>(value));
+    }
+
+    void append_fixed(double value) {
+        static const double scales[] = {1e0, 1e1, 1e2, 1e3, 1e4,
+                                        1e5, 1e6, 1e7, 1e8, 1e9};
+
+        // The scaled value is within one rounding error of the exact one.
+        // When it is that close to a half, rounding it could differ from
+        // rounding the exact binary value, so printf decides.
+        auto scaled = std::fabs(value) * (precision_ <= 9 ? scales[precision_] : 0);
+        auto lower = std::floor(scaled);
+        auto margin = std::fabs(scaled - lower - 0.5);
+
+        if (precision_ > 9 || !(scaled < 1e15) || margin <= scaled * 1e-15) {
+            char text[512];
+            auto length = std::snprintf(text, sizeof(text), "%.*f", precision_, value);
+            buffer_.append(text, static_cast<size_t>(length));
+            return;
+        }
+
+        auto scale = static_cast<uint64_t>(scales[precision_]);
+        auto rounded = static_cast<uint64_t>(lower) + (scaled - lower > 0.5 ? 1 : 0);
+
+        if (std::signbit(value)) {
+            buffer_ += '-';
+        }
+
+        append_unsigned(rounded / scale);
+
+        if (precision_ == 0) {
+            return;
+        }
+
+        char decimals[9];
+        auto remainder = rounded % scale;
+        for (auto i = precision_ - 1; i >= 0; --i) {
+            decimals[i] = static_cast<char>('0' + remainder % 10);
+            remainder /= 10;
+        }
+
+        buffer_ += '.';
+        buffer_.append(decimals, static_cast<size_t>(precision_));
+    }
+
+    std::string buffer_;
+    int precision_;
+};
+
+/// Buffers output for a stream and writes it in large blocks
+class OutputWriter : public OutputBuffer {
+public:
+    explicit OutputWriter(std::ostream& os, int precision = 6,
+                          size_t capacity = 1 << 20)
+        : OutputBuffer(precision), os_(os), capacity_(capacity) {
+        reserve(capacity_ + 4096);
+    }
+
+    ~OutputWriter() {
+        flush();
+    }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    template <typename T>
+    OutputWriter& operator<<(const T& value) {
+        OutputBuffer::operator<<(value);
+        if (size() >= capacity_) {
+            flush();
+        }
+        return *this;
+    }
+
+    void flush() {
+        write(os_);
+        clear();
+        os_.flush();
+    }
+
+private:
+    std::ostream& os_;
+    size_t capacity_;
+};
+
+/// Collector for `lemon::launch` writing the buffers returned by the workers
+/// straight to a stream, without joining them into a string first.
+class buffer_combine {
+public:
+    explicit buffer_combine(std::ostream& os) : os_(os) {}
+
+    void operator()(const OutputBuffer& buffer) {
+        buffer.write(os_);
+    }
+
+    template <typename Container>
+    void operator()(const Container& buffers) {
+        for (const auto& buffer : buffers) {
+            (*this)(buffer);
+        }
+    }
+
+private:
+    std::ostream& os_;
+};
+
+/// One reusable output buffer per worker thread.
+///
+/// Workers append their rows to `local()` and return `take_batch()`, which
+/// hands the rows to the collector only once about `batch` bytes have built
+/// up; otherwise it returns an empty buffer. Rows still buffered when the
+/// workers are done are written by `write`.
+class ThreadBuffers {
+public:
+    explicit ThreadBuffers(int precision = 6, size_t batch = 1 << 20)
+        : precision_(precision), batch_(batch), id_(next_id()) {}
+
+    ThreadBuffers(const ThreadBuffers&) = delete;
+    ThreadBuffers& operator=(const ThreadBuffers&) = delete;
+
+    /// Buffer of the calling thread
+    OutputBuffer& local() {
+        thread_local size_t owner = 0;
+        thread_local OutputBuffer* buffer = nullptr;
+
+        if (owner != id_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.emplace_back(std::make_unique<OutputBuffer>(precision_));
+            buffers_.back()->reserve(batch_ + 4096);
+            buffer = buffers_.back().get();
+            owner = id_;
+        }
+
+        return *buffer;
+    }
+
+    /// Rows of the calling thread once a full batch is buffered
+    OutputBuffer take_batch() {
+        auto& buffer = local();
+        OutputBuffer batch(precision_);
+        if (buffer.size() >= batch_) {
+            batch.swap(buffer);
+            buffer.reserve(batch_ + 4096);
+        }
+        return batch;
+    }
+
+    /// Writes and clears the rows left in every buffer
+    void write(std::ostream& os) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& buffer : buffers_) {
+            buffer->write(os);
+            buffer->clear();
+        }
+    }
+
+private:
+    static size_t next_id() {
+        static std::mutex mutex;
+        static size_t last = 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        return ++last;
+    }
+
+    int precision_;
+    size_t batch_;
+    size_t id_;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<OutputBuffer>> buffers_;
+};
+
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include "spear/scoringfunctions/Bernard12.hpp"
 #include "spear/atomtypes/IDATM.hpp"
 #include "spear/Grid.hpp"
+#include "starmix/OutputBuffer.hpp"
 
 using Spear::Bernard12;
 using Spear::IDATM;
@@ -19,7 +20,10 @@ using Spear::IDATM;
 int main(int argc, char** argv) {
     lemon::Options o;
     std::string distrib("data/csd_distributions.dat");
+    auto precision = 6;
     o.add_option("--dist,-d", distrib, "Location of the distribution file.");
+    o.add_option("--precision", precision,
+                 "Decimals written for scores.");
     o.parse_command_line(argc, argv);
 
     std::ifstream csd_disbrib(distrib);
@@ -59,13 +63,17 @@ int main(int argc, char** argv) {
                                                       "IDATM_geometry"));
     }
 
-    auto worker = [&rmcs, &rccs, &fmcs, &fccs](
+    starmix::ThreadBuffers buffers(precision);
+
+    auto worker = [&rmcs, &rccs, &fmcs, &fccs, &buffers](
                     chemfiles::Frame entry,
                     const std::string& pdbid) {
+        auto& result = buffers.local();
+
         // Selection phase
         std::list<size_t> smallm;
         if (lemon::select::small_molecules(entry, smallm) == 0) {
-            return std::string("");
+            return buffers.take_batch();
         }
 
         // Pruning phase
@@ -74,7 +82,7 @@ int main(int argc, char** argv) {
         lemon::prune::cofactors(entry, smallm, lemon::common_fatty_acids);
 
         if (smallm.empty()) {
-            return std::string("");
+            return buffers.take_batch();
         }
 
         Spear::Molecule mol(entry);
@@ -82,28 +90,30 @@ int main(int argc, char** argv) {
         auto grid = Spear::Grid(mol.positions());
 
         // Output phase
-        std::string result;
         for (auto smallm_id : smallm) {
-            result += pdbid + '\t';
-            result += mol.topology().residues()[smallm_id].name() + '\t';
+            result << pdbid << '\t';
+            result << mol.topology().residues()[smallm_id].name() << '\t';
             for (auto& sf : rmcs) {
-                result += std::to_string(sf->score(grid, mol, smallm_id)) + '\t';
+                result << sf->score(grid, mol, smallm_id) << '\t';
             }
             for (auto& sf : rccs) {
-                result += std::to_string(sf->score(grid, mol, smallm_id)) + '\t';
+                result << sf->score(grid, mol, smallm_id) << '\t';
             }
             for (auto& sf : fmcs) {
-                result += std::to_string(sf->score(grid, mol, smallm_id)) + '\t';
+                result << sf->score(grid, mol, smallm_id) << '\t';
             }
             for (auto& sf : fccs) {
-                result += std::to_string(sf->score(grid, mol, smallm_id)) + '\t';
+                result << sf->score(grid, mol, smallm_id) << '\t';
             }
-            result += '\n';
+            result << '\n';
         }
 
-        return result;
+        return buffers.take_batch();
     };
 
-    auto collector = lemon::print_combine(std::cout);
-    return lemon::launch(o, worker, collector);
+    auto collector = starmix::buffer_combine(std::cout);
+    auto status = lemon::launch(o, worker, collector);
+    buffers.write(std::cout);
+
+    return status;
 }
@@ -9,18 +9,23 @@
 #include "spear/atomtypes/IDATM.hpp"
 #include "spear/Grid.hpp"
 #include "spear/Geometry.hpp"
+#include "starmix/OutputBuffer.hpp"
+#include "starmix/DistanceHistogram.hpp"
 
 using Spear::IDATM;
 using Spear::atomtype_name_for_id;
 using Spear::van_der_waals;
 
-typedef std::pair<std::string, size_t> DistanceBin;
-typedef std::map<DistanceBin, size_t> DistanceCounts;
-
 int main(int argc, char** argv) {
     lemon::Options o;
     auto bin_size = 0.001;
     auto max_dist = 15.0;
+    auto precision = 6;
+    size_t min_bin_count = 0;
+    auto max_bin_width = 0.0;
+    size_t min_pair_count = 0;
+    auto bandwidth = 0.0;
+    auto kde_step = 0.01;
     auto vdw_coef = 0.75;
     o.add_option("--bin_size,-b", bin_size,
                  "Bin size. Larger value is a coarser potential.");
@@ -28,11 +33,37 @@ int main(int argc, char** argv) {
                  "Maximum distance");
     o.add_option("--vdw_coef,-c", vdw_coef,
                  "Van der Waals scaling coeficient. Used to determine min distance");
+    o.add_option("--precision", precision,
+                 "Decimals written for distances.");
+    o.add_option("--min_bin_count", min_bin_count,
+                 "Merge neighboring bins until each holds this many counts. Not used with --bandwidth.");
+    o.add_option("--max_bin_width", max_bin_width,
+                 "Widest span of merged bins, 0 for ten bins. Merged counts are spread back over the bins.");
+    o.add_option("--min_pair_count", min_pair_count,
+                 "Leave out type pairs with fewer counts than this.");
+    o.add_option("--bandwidth", bandwidth,
+                 "Write a Gaussian kernel density with this bandwidth, rounded to integer counts, instead of the raw counts.");
+    o.add_option("--kde_step", kde_step,
+                 "Distance between the samples of the kernel density.");
     o.parse_command_line(argc, argv);
 
+    if (!(max_bin_width >= 0) || std::isinf(max_bin_width)) {
+        std::cerr << "The maximum bin width must be zero or a positive number" << std::endl;
+        return 1;
+    }
+
+    if (bandwidth != 0) {
+        try {
+            starmix::check_density_settings(bandwidth, kde_step, max_dist);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     auto worker = [bin_size,max_dist,vdw_coef](chemfiles::Frame entry,
                                                const std::string& pdbid) {
-        DistanceCounts bins;
+        starmix::DistanceHistograms bins;
 
         // Selection phase
         auto smallm = lemon::select::small_molecules(entry);
@@ -73,29 +104,26 @@ int main(int argc, char** argv) {
 
                     auto dist_bin = static_cast<size_t>(std::floor(dist / bin_size));
 
-                    DistanceBin sbin = {bin_name, dist_bin};
-                    auto bin_iterator = bins.find(sbin);
-
-                    if (bin_iterator == bins.end()) {
-                        bins[sbin] = 1;
-                        continue;
-                    }
-
-                    ++(bin_iterator->second);
+                    bins.add(bin_name, dist_bin);
                 }
             }
         }
+
+        bins.compress();
         return bins;
     };
 
-    DistanceCounts total;
-    auto collector = lemon::map_combine<DistanceCounts>(total);
+    starmix::DistanceHistograms total;
+    auto collector = starmix::histogram_combine(total);
     lemon::launch(o, worker, collector);
 
-    for (const auto& i : total) {
-        std::cout << i.first.first << "\t"
-                  << static_cast<double>(i.first.second) * bin_size << "\t"
-                  << i.second << "\n";
+    starmix::OutputWriter out(std::cout, precision);
+    if (bandwidth != 0) {
+        starmix::write_densities(out, total, bin_size, bandwidth, kde_step,
+                                 max_dist, min_pair_count);
+    } else {
+        starmix::write_histograms(out, total, bin_size, min_bin_count, min_pair_count,
+                                  max_bin_width);
     }
 
     return 0;
@@ -8,6 +8,8 @@
 #include "spear/Grid.hpp"
 #include "spear/Geometry.hpp"
 #include "chemfiles.hpp"
+#include "starmix/Arguments.hpp"
+#include "starmix/OutputBuffer.hpp"
 
 using Spear::Bernard12;
 using Spear::IDATM;
@@ -15,6 +17,15 @@ using Spear::IDATM;
 using sf_vector = std::vector<std::unique_ptr<Spear::ScoringFunction>>;
 
 int main(int argc, char** argv) {
+    auto precision = 6;
+
+    starmix::Arguments args("score_all_residues protein distributions "
+                            "[--precision decimals]", 2);
+    args.option("--precision", precision);
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
     auto mol = Spear::Molecule(chemfiles::Trajectory(argv[1]).read());
     auto grid = Spear::Grid(mol.positions());
 
@@ -93,11 +104,12 @@ int main(int argc, char** argv) {
                                                       idatm_name));
     }
 
-    std::cout << "chain\tresi\tresn";
+    starmix::OutputWriter out(std::cout, precision);
+    out << "chain\tresi\tresn";
 
-    auto print_names = [](std::string sf) {
+    auto print_names = [&out](const std::string& sf) {
         for (auto r = 4; r <= 15; r += 1) {
-            std::cout << "\t" << sf << r;
+            out << "\t" << sf << r;
         }
     };
 
@@ -110,41 +122,41 @@ int main(int argc, char** argv) {
     print_names("fmc");
     print_names("fcc");
 
-    std::cout << "\tsize\n";
+    out << "\tsize\n";
 
     auto& residues = mol.topology().residues();
     for (size_t i = 0; i < residues.size(); ++i) {
 
         auto& res = residues[i];
 
-        std::cout << res.get<chemfiles::Property::STRING>("chainid").value_or("X")
-                  << "\t" << *(res.id())
-                  << "\t" << res.name() << "\t";
+        out << res.get<chemfiles::Property::STRING>("chainid").value_or("X")
+            << "\t" << *(res.id())
+            << "\t" << res.name() << "\t";
         for (auto& sf : rmrs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : rcrs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : fmrs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : fcrs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : rmcs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : rccs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : fmcs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
         for (auto& sf : fccs) {
-            std::cout << std::to_string(sf->score(grid, mol, i)) << '\t';
+            out << sf->score(grid, mol, i) << '\t';
         }
-        std::cout << res.size() << '\n';
+        out << res.size() << '\n';
     }
 
 }
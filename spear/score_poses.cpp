@@ -2,12 +2,16 @@
 // Copyright (C) Purdue University -- BSD license
 
 #include <iostream>
+#include <memory>
 #include "spear/Molecule.hpp"
 #include "spear/scoringfunctions/Bernard12.hpp"
 #include "spear/atomtypes/IDATM.hpp"
 #include "spear/Grid.hpp"
 #include "spear/Geometry.hpp"
 #include "chemfiles.hpp"
+#include "starmix/Arguments.hpp"
+#include "starmix/LigandReader.hpp"
+#include "starmix/OutputBuffer.hpp"
 
 using Spear::Bernard12;
 using Spear::IDATM;
@@ -15,12 +19,35 @@ using Spear::IDATM;
 using sf_vector = std::vector<std::unique_ptr<Spear::ScoringFunction>>;
 
 int main(int argc, char** argv) {
+    std::string range;
+    std::string shard;
+    auto precision = 6;
+
+    starmix::Arguments args("score_poses protein ligands distributions "
+                            "[--range start:end] [--shard i/N] [--precision decimals]", 3);
+    args.option("--range", range);
+    args.option("--shard", shard);
+    args.option("--precision", precision);
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    std::unique_ptr<starmix::LigandInput> ligands;
+    chemfiles::Frame first_ligand;
+    try {
+        ligands = std::make_unique<starmix::LigandInput>(argv[2], range, shard);
+        first_ligand = ligands->first();
+    } catch (const std::exception& e) {
+        args.error(e.what());
+        return 1;
+    }
+
     auto prot = Spear::Molecule(chemfiles::Trajectory(argv[1]).read());
     auto grid = Spear::Grid(prot.positions());
     auto idatm_name = prot.add_atomtype<Spear::IDATM>(Spear::AtomType::GEOMETRY);
     auto types1 = prot.atomtype(idatm_name);
 
-    auto lign = Spear::Molecule(chemfiles::Trajectory(argv[2]).read());
+    auto lign = Spear::Molecule(first_ligand);
     auto types2 = lign.atomtype(lign.add_atomtype<Spear::IDATM>(Spear::AtomType::GEOMETRY));
 
     std::unordered_set<size_t> all_types;
@@ -98,11 +125,12 @@ int main(int argc, char** argv) {
                                                       idatm_name));
     }
 
-    std::cout << "name";
+    starmix::OutputWriter out(std::cout, precision);
+    out << "name";
 
-    auto print_names = [](std::string sf) {
+    auto print_names = [&out](const std::string& sf) {
         for (auto r = 4; r <= 15; r += 1) {
-            std::cout << "\t" << sf << r;
+            out << "\t" << sf << r;
         }
     };
 
@@ -115,43 +143,41 @@ int main(int argc, char** argv) {
     print_names("fmc");
     print_names("fcc");
 
-    std::cout << "\tsize\n";
+    out << "\tsize\n";
 
-    auto ltraj = chemfiles::Trajectory(argv[2]);
-    while (!ltraj.done()) {
-        auto frame = ltraj.read();
-        
-        std::cout << frame.get<chemfiles::Property::STRING>("name").value_or("XXXX");
-        std::cout << "\t";
+    chemfiles::Frame frame;
+    while (ligands->next(frame)) {
+        out << frame.get<chemfiles::Property::STRING>("name").value_or("XXXX");
+        out << "\t";
 
         auto mol = Spear::Molecule(frame);
         //mol.remove_hydrogens();
         mol.add_atomtype<Spear::IDATM>(Spear::AtomType::GEOMETRY);
 
         for (auto& sf : rmrs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : rcrs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : fmrs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : fcrs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : rmcs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : rccs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : fmcs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
         for (auto& sf : fccs) {
-            std::cout << std::to_string(sf->score(grid, prot, mol)) << '\t';
+            out << sf->score(grid, prot, mol) << '\t';
         }
-        std::cout << mol.size() << '\n';
+        out << mol.size() << '\n';
     }
 }
@@ -2,6 +2,7 @@
 // Copyright (C) Purdue University -- BSD license
 
 #include <iostream>
+#include <memory>
 
 #include "spear/Molecule.hpp"
 #include "spear/scoringfunctions/VinaScore.hpp"
@@ -9,35 +10,57 @@
 #include "spear/Grid.hpp"
 #include "spear/Geometry.hpp"
 #include "chemfiles.hpp"
+#include "starmix/Arguments.hpp"
+#include "starmix/LigandReader.hpp"
+#include "starmix/OutputBuffer.hpp"
 
 using sf_vector = std::vector<std::unique_ptr<Spear::ScoringFunction>>;
 
 int main(int argc, char** argv) {
+    std::string range;
+    std::string shard;
+    auto precision = 6;
+
+    starmix::Arguments args("score_poses_vina protein ligands "
+                            "[--range start:end] [--shard i/N] [--precision decimals]", 2);
+    args.option("--range", range);
+    args.option("--shard", shard);
+    args.option("--precision", precision);
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    std::unique_ptr<starmix::LigandInput> ligands;
+    try {
+        ligands = std::make_unique<starmix::LigandInput>(argv[2], range, shard);
+    } catch (const std::exception& e) {
+        args.error(e.what());
+        return 1;
+    }
+
     auto prot = Spear::Molecule(chemfiles::Trajectory(argv[1]).read());
     auto grid = Spear::Grid(prot.positions());
     prot.add_atomtype<Spear::VinaType>();
 
     Spear::VinaScore scoring_func;
 
-    std::cout << "name\tg1\tg2\trep\thydrogen\thydrophobic\tvina\n";
-
-    auto ltraj = chemfiles::Trajectory(argv[2]);
+    starmix::OutputWriter out(std::cout, precision);
+    out << "name\tg1\tg2\trep\thydrogen\thydrophobic\tvina\n";
 
-    while (!ltraj.done()) {
-        auto frame = ltraj.read();
-        
-        std::cout << frame.get<chemfiles::Property::STRING>("name").value_or("XXXX");
-        std::cout << "\t";
+    chemfiles::Frame frame;
+    while (ligands->next(frame)) {
+        out << frame.get<chemfiles::Property::STRING>("name").value_or("XXXX");
+        out << "\t";
 
         auto mol = Spear::Molecule(frame);
         mol.add_atomtype<Spear::VinaType>();
 
         auto thing = scoring_func.calculate_components(grid, prot, mol);
-        std::cout << thing.g1 << "\t";
-        std::cout << thing.g2 << "\t";
-        std::cout << thing.rep << "\t";
-        std::cout << thing.hydrogen  << "\t";
-        std::cout << thing.hydrophobic << "\t";
-        std::cout << scoring_func.score(grid, prot, mol) << "\n";
+        out << thing.g1 << "\t";
+        out << thing.g2 << "\t";
+        out << thing.rep << "\t";
+        out << thing.hydrogen  << "\t";
+        out << thing.hydrophobic << "\t";
+        out << scoring_func.score(grid, prot, mol) << "\n";
     }
 }
@@ -0,0 +1,82 @@
+// StarMix: A collection of programs which use the CANDIY suite
+// Copyright (C) Purdue University -- BSD license
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include "spear/Molecule.hpp"
+#include "spear/FunctionalGroup.hpp"
+#include "chemfiles.hpp"
+#include "starmix/Arguments.hpp"
+#include "starmix/FunctionalGroupRules.hpp"
+
+int main(int argc, char **argv) {
+    starmix::Arguments args("screen_functional_groups input output rules\n"
+                            "Matching cost scales with the number of distinct "
+                            "SMARTS patterns in the rule file.", 3);
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    std::ifstream rule_file(argv[3]);
+    if (!rule_file) {
+        args.error(std::string("Could not open rule file ") + argv[3]);
+        return 1;
+    }
+
+    // Rules and input are checked before the output file is created
+    std::unique_ptr<const starmix::FunctionalGroupRules> rules;
+    std::unique_ptr<chemfiles::Trajectory> in_traj;
+    std::unique_ptr<chemfiles::Trajectory> ou_traj;
+    try {
+        rules = std::make_unique<const starmix::FunctionalGroupRules>(rule_file);
+        in_traj = std::make_unique<chemfiles::Trajectory>(argv[1]);
+        ou_traj = std::make_unique<chemfiles::Trajectory>(argv[2], 'w');
+    } catch (const std::exception& e) {
+        args.error(e.what());
+        return 1;
+    }
+
+    size_t kept = 0;
+    size_t skipped = 0;
+    size_t failed = 0;
+    while (!in_traj->done()) {
+        chemfiles::Frame curr_frame;
+        try {
+            curr_frame = in_traj->read();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: could not read molecule " << kept + skipped + failed + 1
+                      << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        auto name = curr_frame.get<chemfiles::Property::STRING>("name").value_or("XXXX");
+
+        std::string failed_rule;
+        try {
+            failed_rule = rules->apply(curr_frame);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: could not apply the rules to " << name << ": "
+                      << e.what() << std::endl;
+            ++failed;
+            continue;
+        }
+
+        if (!failed_rule.empty()) {
+            std::cout << "Skipping " << name << " as it fails rule " << failed_rule << ".\n";
+            ++skipped;
+            continue;
+        }
+
+        ou_traj->write(curr_frame);
+        ++kept;
+    }
+
+    std::cout << "Kept " << kept << " and skipped " << skipped << " molecules using "
+              << rules->size() << " rules (" << rules->patterns() << " patterns)." << std::endl;
+
+    if (failed != 0) {
+        std::cerr << "Error: " << failed << " molecules could not be screened" << std::endl;
+        return 1;
+    }
+}